@@ -0,0 +1,703 @@
+﻿// -----------------------------------------------------------------------------
+// bench.cpp – CLMath 基准 & 回归程序
+//
+// 扫描数组规模 / 帧与模板尺寸 / 线程数 / 设备，输出延迟分位数、吞吐量、
+// 上传/计算/回读耗时拆分，并与主机参考结果比对。结果写成 JSON，
+// 可用 --baseline 与旧版本的结果比较中位延迟，发现性能回退。
+//
+// 退出码：0 正常；1 结果校验失败；2 相对基线有回退；
+//         3 基线不可比（没有可比条目，或本次结果少于基线）；
+//         64 参数错误；77 没有可用的 OpenCL 运行时或设备
+// -----------------------------------------------------------------------------
+#ifdef _WIN32
+#define NOMINMAX
+#endif
+#include "pch.h"
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cmath>
+#include <cstdint>
+#include <cstdio>
+#include <cstdlib>
+#include <exception>
+#include <fstream>
+#include <map>
+#include <sstream>
+#include <stdexcept>
+#include <string>
+#include <thread>
+#include <vector>
+
+using Clock = std::chrono::steady_clock;
+
+// -----------------------------------------------------------------------------
+// 命令行参数
+// -----------------------------------------------------------------------------
+struct Options
+{
+    std::vector<int>                 sizes     = { 1 << 10, 1 << 12, 1 << 14, 1 << 16, 1 << 18, 1 << 20, 1 << 22 };
+    std::vector<std::pair<int, int>> frames    = { { 640, 480 }, { 1920, 1080 } };   // W x H
+    std::vector<std::pair<int, int>> templates = { { 16, 16 }, { 64, 64 } };         // W x H
+    std::vector<int>                 threads   = { 1, 2, 4 };
+    std::vector<int>                 devices;                                         // 空 = 全部
+    std::vector<std::string>         ops       = { "add", "sub", "mul", "div", "slide" };
+    int         times     = 1024;
+    int         reps      = 30;
+    int         warmup    = 3;
+    bool        tune      = false;
+    bool        reorder   = false;
+    std::string json;
+    std::string baseline;
+    double      tolerance = 0.10;
+};
+
+static void PrintUsage()
+{
+    std::printf(
+        "usage: clmath_bench [options]\n"
+        "  --sizes N,N,...        数组元素数（CL_Add/Sub/Mul/Div）\n"
+        "  --frames WxH,...       SlideOnce 大图尺寸\n"
+        "  --templates WxH,...    SlideOnce 模板尺寸\n"
+        "  --times N              SlideOnce 窗口数（默认 1024）\n"
+        "  --threads N,N,...      并发调用线程数\n"
+        "  --devices I,I,...      设备序号（默认全部；SlideOnce 固定用设备 0）\n"
+        "  --ops add,sub,mul,div,slide\n"
+        "  --reps N               每线程计时次数（默认 30）\n"
+        "  --warmup N             每线程预热次数（默认 3）\n"
+        "  --tune                 开始前调用 CL_Tune(-1) 重新调优\n"
+        "  --reorder              调用 CL_SetReorder(1)，测量 Add/Mul 的并行归约路径\n"
+        "  --quick                小规模扫描（冒烟 / CI 用）\n"
+        "  --json FILE            结果写入 JSON\n"
+        "  --baseline FILE        与旧 JSON 比较中位延迟\n"
+        "  --tolerance X          允许的回退比例（默认 0.10）\n");
+}
+
+static std::vector<std::string> Split(const std::string& s, char sep)
+{
+    std::vector<std::string> out;
+    std::stringstream ss(s);
+    std::string item;
+    while (std::getline(ss, item, sep))
+        if (!item.empty()) out.push_back(item);
+    return out;
+}
+
+static std::vector<int> ParseInts(const std::string& s)
+{
+    std::vector<int> out;
+    for (const auto& item : Split(s, ','))
+    {
+        int v = std::stoi(item);
+        if (v <= 0) throw std::invalid_argument(item);
+        out.push_back(v);
+    }
+    return out;
+}
+
+static std::vector<std::pair<int, int>> ParseDims(const std::string& s)
+{
+    std::vector<std::pair<int, int>> out;
+    for (const auto& item : Split(s, ','))
+    {
+        size_t x = item.find('x');
+        if (x == std::string::npos) throw std::invalid_argument(item);
+        int w = std::stoi(item.substr(0, x));
+        int h = std::stoi(item.substr(x + 1));
+        if (w <= 0 || h <= 0) throw std::invalid_argument(item);
+        out.emplace_back(w, h);
+    }
+    return out;
+}
+
+static Options ParseArgs(int argc, char** argv)
+{
+    Options opt;
+    for (int i = 1; i < argc; ++i)
+    {
+        std::string a = argv[i];
+        auto next = [&]() -> std::string {
+            if (i + 1 >= argc) throw std::invalid_argument(a + " 缺少参数");
+            return argv[++i];
+        };
+        if      (a == "--sizes")     opt.sizes     = ParseInts(next());
+        else if (a == "--frames")    opt.frames    = ParseDims(next());
+        else if (a == "--templates") opt.templates = ParseDims(next());
+        else if (a == "--times")     opt.times     = ParseInts(next()).at(0);
+        else if (a == "--threads")   opt.threads   = ParseInts(next());
+        else if (a == "--devices")
+        {
+            opt.devices.clear();
+            for (const auto& item : Split(next(), ','))
+                opt.devices.push_back(std::stoi(item));
+        }
+        else if (a == "--ops")
+        {
+            opt.ops = Split(next(), ',');
+            for (const auto& op : opt.ops)
+                if (op != "add" && op != "sub" && op != "mul" && op != "div" && op != "slide")
+                    throw std::invalid_argument("未知运算 " + op);
+        }
+        else if (a == "--reps")      opt.reps      = ParseInts(next()).at(0);
+        else if (a == "--warmup")    opt.warmup    = std::stoi(next());
+        else if (a == "--tune")      opt.tune      = true;
+        else if (a == "--reorder")   opt.reorder   = true;
+        else if (a == "--json")      opt.json      = next();
+        else if (a == "--baseline")  opt.baseline  = next();
+        else if (a == "--tolerance") opt.tolerance = std::stod(next());
+        else if (a == "--quick")
+        {
+            opt.sizes     = { 1000, 1 << 16 };
+            opt.frames    = { { 320, 240 } };
+            opt.templates = { { 16, 16 } };
+            opt.threads   = { 1, 2 };
+            opt.times     = 256;
+            opt.reps      = 5;
+            opt.warmup    = 1;
+        }
+        else if (a == "-h" || a == "--help")
+        {
+            PrintUsage();
+            std::exit(0);
+        }
+        else
+            throw std::invalid_argument("未知参数 " + a);
+    }
+    return opt;
+}
+
+// -----------------------------------------------------------------------------
+// 输入数据与主机参考实现
+// -----------------------------------------------------------------------------
+static uint64_t g_rng = 0x2545F4914F6CDD1DULL;
+
+// [0, 1) 均匀分布，固定种子保证每次运行输入相同
+static double NextUnit()
+{
+    g_rng = g_rng * 6364136223846793005ULL + 1442695040888963407ULL;
+    return (double)(g_rng >> 11) * (1.0 / 9007199254740992.0);
+}
+
+// 与库内串行核相同的计算次序
+static double HostReduce(const std::string& op, const std::vector<double>& a)
+{
+    if (a.empty()) return (op == "mul") ? 1.0 : 0.0;
+    double v = (op == "add") ? 0.0 : (op == "mul") ? 1.0 : a[0];
+    size_t i0 = (op == "sub" || op == "div") ? 1 : 0;
+    for (size_t i = i0; i < a.size(); ++i)
+    {
+        if      (op == "add") v += a[i];
+        else if (op == "sub") v -= a[i];
+        else if (op == "mul") v *= a[i];
+        else                  v /= a[i];
+    }
+    return v;
+}
+
+// 与 slide_k + SlideOnce 过滤逻辑一致，返回有效窗口数
+static int HostSlide(const std::vector<int>& big, int bigH, int bigW,
+                     const std::vector<int>& tpl, int tplH, int tplW,
+                     int times, std::vector<float>& scores, std::vector<int>& infos)
+{
+    int rows    = (int)std::ceil(std::sqrt((double)times));
+    int cols    = (int)std::ceil((double)times / rows);
+    int strideY = (rows <= 1) ? (bigH - tplH) : (bigH - tplH) / (rows - 1);
+    int strideX = (cols <= 1) ? (bigW - tplW) : (bigW - tplW) / (cols - 1);
+    int maxSAD  = 255 * tplH * tplW;
+    int valid   = 0;
+    for (int gid = 0; gid < rows * cols; ++gid)
+    {
+        int y0 = (gid / cols) * strideY;
+        int x0 = (gid % cols) * strideX;
+        if (y0 + tplH > bigH || x0 + tplW > bigW) continue;
+        int sad = 0;
+        for (int u = 0; u < tplH; ++u)
+            for (int v = 0; v < tplW; ++v)
+                sad += std::abs(big[(y0 + u) * bigW + x0 + v] - tpl[u * tplW + v]);
+        scores[valid] = 1.f - (float)sad / (float)maxSAD;
+        infos[valid * 4 + 0] = x0;
+        infos[valid * 4 + 1] = y0;
+        infos[valid * 4 + 2] = tplW;
+        infos[valid * 4 + 3] = tplH;
+        ++valid;
+    }
+    return valid;
+}
+
+// -----------------------------------------------------------------------------
+// 计时
+// -----------------------------------------------------------------------------
+struct Sample
+{
+    double latency;    // 整次调用（毫秒）
+    double upload;     // 以下来自 CL_GetLastTiming
+    double compute;
+    double download;
+};
+
+struct Result
+{
+    std::string key;
+    std::string op;
+    int         device = 0;
+    std::string deviceName;
+    std::string shape;           // 元素数或 帧/模板 尺寸
+    int         threads = 1;
+    bool        reorder = false;         // Add / Mul 是否允许并行归约
+    double      bytesPerCall = 0;
+    double      elemsPerCall = 0;
+    int         calls = 0;
+    double      p50 = 0, p90 = 0, p99 = 0, minMs = 0, mean = 0;
+    double      upload = 0, compute = 0, download = 0;   // 中位数
+    double      gbps = 0, elemsPerSec = 0;
+    double      maxErr = 0;
+    bool        ok = true;
+};
+
+// 最近秩法取分位数，v 须已排序
+static double Percentile(const std::vector<double>& v, double p)
+{
+    if (v.empty()) return 0.0;
+    size_t rank = (size_t)std::ceil(p / 100.0 * v.size());
+    return v[rank == 0 ? 0 : rank - 1];
+}
+
+static double Median(std::vector<double> v)
+{
+    std::sort(v.begin(), v.end());
+    return Percentile(v, 50.0);
+}
+
+// threads 个线程同时调用 call，每线程先预热 warmup 次再计时 reps 次；
+// call 返回本次结果相对主机参考的误差。工作线程中的异常在汇合后于调用线程重新抛出
+template <class F>
+static void Measure(int threads, int warmup, int reps, F&& call, Result& res)
+{
+    std::vector<std::vector<Sample>> samples(threads);
+    std::vector<double>              errs(threads, 0.0);
+    std::vector<std::exception_ptr>  failures(threads);
+    std::atomic<int>                 ready(0);
+    std::atomic<bool>                go(false);
+    Clock::time_point                start;
+
+    auto worker = [&](int tid)
+    {
+        bool counted = false;
+        try
+        {
+            for (int i = 0; i < warmup; ++i)
+                errs[tid] = (std::max)(errs[tid], call());
+            ++ready;
+            counted = true;
+            while (!go.load()) std::this_thread::yield();
+            samples[tid].reserve(reps);
+            for (int i = 0; i < reps; ++i)
+            {
+                auto t0 = Clock::now();
+                double err = call();
+                auto t1 = Clock::now();
+                Sample s;
+                s.latency = std::chrono::duration<double, std::milli>(t1 - t0).count();
+                CL_GetLastTiming(&s.upload, &s.compute, &s.download);
+                samples[tid].push_back(s);
+                errs[tid] = (std::max)(errs[tid], err);
+            }
+        }
+        catch (...)
+        {
+            failures[tid] = std::current_exception();
+            if (!counted) ++ready;   // 预热阶段失败也要放行主线程
+        }
+    };
+
+    std::vector<std::thread> pool;
+    for (int t = 0; t < threads; ++t)
+        pool.emplace_back(worker, t);
+    while (ready.load() < threads) std::this_thread::yield();
+    start = Clock::now();
+    go = true;
+    for (auto& th : pool) th.join();
+    double wall = std::chrono::duration<double>(Clock::now() - start).count();
+    for (const auto& f : failures)
+        if (f) std::rethrow_exception(f);
+
+    std::vector<double> lat, up, comp, down;
+    for (const auto& per : samples)
+        for (const auto& s : per)
+        {
+            lat.push_back(s.latency);
+            up.push_back(s.upload);
+            comp.push_back(s.compute);
+            down.push_back(s.download);
+        }
+    std::sort(lat.begin(), lat.end());
+
+    res.threads  = threads;
+    res.calls    = (int)lat.size();
+    res.p50      = Percentile(lat, 50.0);
+    res.p90      = Percentile(lat, 90.0);
+    res.p99      = Percentile(lat, 99.0);
+    res.minMs    = lat.empty() ? 0.0 : lat.front();
+    double sum = 0.0;
+    for (double v : lat) sum += v;
+    res.mean     = lat.empty() ? 0.0 : sum / lat.size();
+    res.upload   = Median(up);
+    res.compute  = Median(comp);
+    res.download = Median(down);
+    if (wall > 0)
+    {
+        res.gbps        = res.bytesPerCall * res.calls / wall / 1e9;
+        res.elemsPerSec = res.elemsPerCall * res.calls / wall;
+    }
+    for (double e : errs) res.maxErr = (std::max)(res.maxErr, e);
+}
+
+// -----------------------------------------------------------------------------
+// 用例
+// -----------------------------------------------------------------------------
+typedef double(__cdecl* ReduceFn)(const double*, int, int);
+
+static ReduceFn ReduceOf(const std::string& op)
+{
+    if (op == "add") return CL_Add;
+    if (op == "sub") return CL_Sub;
+    if (op == "mul") return CL_Mul;
+    if (op == "div") return CL_Div;
+    return nullptr;
+}
+
+// 允许的相对误差：--reorder 下 Add / Mul 的并行归约与串行次序不同，误差上界约为 n * eps
+static constexpr double kReduceTol = 1e-8;
+static constexpr double kSlideTol  = 1e-5;
+
+static void BenchReduce(const Options& opt, const std::string& op, int dev,
+                        const std::string& devName, std::vector<Result>& out)
+{
+    ReduceFn fn = ReduceOf(op);
+    bool mul = (op == "mul" || op == "div");
+    for (int n : opt.sizes)
+    {
+        /* 加减用 [0.5, 1.5)，乘除用 1 附近的值避免溢出 */
+        std::vector<double> a(n);
+        for (auto& v : a)
+            v = mul ? 1.0 + (NextUnit() - 0.5) * 1e-6 : 0.5 + NextUnit();
+        double ref   = HostReduce(op, a);
+        double scale = 0.0;
+        if (mul)
+            scale = std::fabs(ref);
+        else
+            for (double v : a) scale += std::fabs(v);
+        if (scale == 0.0) scale = 1.0;
+
+        for (int t : opt.threads)
+        {
+            Result r;
+            r.op           = op;
+            r.device       = dev;
+            r.deviceName   = devName;
+            r.shape        = std::to_string(n);
+            r.reorder      = opt.reorder && (op == "add" || op == "mul");
+            r.bytesPerCall = (double)n * sizeof(double) + sizeof(double);
+            r.elemsPerCall = n;
+            Measure(t, opt.warmup, opt.reps,
+                    [&] { return std::fabs(fn(a.data(), n, dev) - ref) / scale; }, r);
+            r.ok = r.maxErr <= kReduceTol;
+            out.push_back(r);
+        }
+    }
+}
+
+static void BenchSlide(const Options& opt, const std::string& devName, std::vector<Result>& out)
+{
+    for (const auto& fr : opt.frames)
+    {
+        for (const auto& tp : opt.templates)
+        {
+            int bigW = fr.first, bigH = fr.second;
+            int tplW = tp.first, tplH = tp.second;
+            if (tplW > bigW || tplH > bigH) continue;
+
+            std::vector<int> big(bigW * bigH), tpl(tplW * tplH);
+            for (auto& v : big) v = (int)(NextUnit() * 256);
+            for (auto& v : tpl) v = (int)(NextUnit() * 256);
+
+            int rows  = (int)std::ceil(std::sqrt((double)opt.times));
+            int total = rows * (int)std::ceil((double)opt.times / rows);
+            std::vector<float> refSco(total);
+            std::vector<int>   refInf(total * 4);
+            int refValid = HostSlide(big, bigH, bigW, tpl, tplH, tplW, opt.times, refSco, refInf);
+
+            for (int t : opt.threads)
+            {
+                Result r;
+                r.op           = "slide";
+                r.device       = 0;
+                r.deviceName   = devName;
+                r.shape        = std::to_string(bigW) + "x" + std::to_string(bigH) + "/" +
+                                 std::to_string(tplW) + "x" + std::to_string(tplH) + "/" +
+                                 std::to_string(opt.times);
+                r.bytesPerCall = (double)(big.size() + tpl.size()) * sizeof(int) +
+                                 (double)total * (sizeof(float) + sizeof(cl_int4));
+                r.elemsPerCall = (double)refValid * tplW * tplH;   // 参与 SAD 的像素数
+                Measure(t, opt.warmup, opt.reps, [&] {
+                    /* 每线程独立输出缓冲区 */
+                    thread_local std::vector<float> sco;
+                    thread_local std::vector<int>   inf;
+                    sco.assign(total, 0.f);
+                    inf.assign(total * 4, 0);
+                    int valid = SlideOnce(big.data(), bigH, bigW, tpl.data(), tplH, tplW,
+                                          opt.times, sco.data(), inf.data());
+                    if (valid != refValid) return 1.0;
+                    double err = 0.0;
+                    for (int i = 0; i < valid; ++i)
+                    {
+                        err = (std::max)(err, (double)std::fabs(sco[i] - refSco[i]));
+                        for (int k = 0; k < 4; ++k)
+                            if (inf[i * 4 + k] != refInf[i * 4 + k]) return 1.0;
+                    }
+                    return err;
+                }, r);
+                r.ok = r.maxErr <= kSlideTol;
+                out.push_back(r);
+            }
+        }
+    }
+}
+
+// -----------------------------------------------------------------------------
+// 输出与基线比较
+// -----------------------------------------------------------------------------
+static std::string JsonEscape(const std::string& s)
+{
+    std::string o;
+    for (char c : s)
+    {
+        if (c == '"' || c == '\\') { o += '\\'; o += c; }
+        else if ((unsigned char)c < 0x20) o += ' ';
+        else o += c;
+    }
+    return o;
+}
+
+static void PrintResult(const Result& r)
+{
+    std::printf("%-5s %-3d %-22s %3d | %9.4f %9.4f %9.4f | %8.4f %8.4f %8.4f | %8.3f %10.4g | %s\n",
+                r.op.c_str(), r.device, r.shape.c_str(), r.threads,
+                r.p50, r.p90, r.p99,
+                r.upload, r.compute, r.download,
+                r.gbps, r.elemsPerSec,
+                r.ok ? "ok" : "MISMATCH");
+}
+
+// 每条结果占一行，便于 ReadBaseline 按行解析
+static bool WriteJson(const std::string& path, const std::vector<Result>& results)
+{
+    std::ofstream f(path, std::ios::trunc);
+    if (!f) return false;
+    f << "{\n  \"version\": 1,\n  \"results\": [\n";
+    for (size_t i = 0; i < results.size(); ++i)
+    {
+        const Result& r = results[i];
+        char num[512];
+        std::snprintf(num, sizeof(num),
+                      "\"threads\": %d, \"reorder\": %s, \"calls\": %d, "
+                      "\"p50_ms\": %.6f, \"p90_ms\": %.6f, \"p99_ms\": %.6f, \"min_ms\": %.6f, \"mean_ms\": %.6f, "
+                      "\"upload_ms\": %.6f, \"compute_ms\": %.6f, \"download_ms\": %.6f, "
+                      "\"gb_per_s\": %.6f, \"elems_per_s\": %.6g, \"max_err\": %.3g, \"ok\": %s",
+                      r.threads, r.reorder ? "true" : "false", r.calls,
+                      r.p50, r.p90, r.p99, r.minMs, r.mean,
+                      r.upload, r.compute, r.download,
+                      r.gbps, r.elemsPerSec, r.maxErr, r.ok ? "true" : "false");
+        f << "    {\"key\": \"" << JsonEscape(r.key) << "\", \"op\": \"" << r.op
+          << "\", \"device\": " << r.device << ", \"device_name\": \"" << JsonEscape(r.deviceName)
+          << "\", \"shape\": \"" << r.shape << "\", " << num << "}"
+          << (i + 1 < results.size() ? ",\n" : "\n");
+    }
+    f << "  ]\n}\n";
+    return (bool)f;
+}
+
+// 读取旧 JSON：key -> p50_ms
+static std::map<std::string, double> ReadBaseline(const std::string& path)
+{
+    std::map<std::string, double> base;
+    std::ifstream f(path);
+    if (!f) throw std::runtime_error("无法打开基线文件 " + path);
+    std::string line;
+    const std::string kKey = "\"key\": \"", kP50 = "\"p50_ms\": ";
+    while (std::getline(f, line))
+    {
+        size_t k = line.find(kKey), p = line.find(kP50);
+        if (k == std::string::npos || p == std::string::npos) continue;
+        /* 反转义，与 Result::key 的原始形式比较 */
+        std::string key;
+        for (size_t e = k + kKey.size(); e < line.size() && line[e] != '"'; ++e)
+        {
+            if (line[e] == '\\' && e + 1 < line.size()) ++e;
+            key += line[e];
+        }
+        base[key] = std::atof(line.c_str() + p + kP50.size());
+    }
+    return base;
+}
+
+// -----------------------------------------------------------------------------
+int main(int argc, char** argv)
+{
+    Options opt;
+    try
+    {
+        opt = ParseArgs(argc, argv);
+    }
+    catch (const std::exception& e)
+    {
+        std::fprintf(stderr, "参数错误: %s\n", e.what());
+        PrintUsage();
+        return 64;
+    }
+
+    int devCount = 0;
+    try
+    {
+        devCount = GetDeviceNamesCount();
+    }
+    catch (const std::exception& e)
+    {
+        std::fprintf(stderr, "OpenCL 不可用: %s\n", e.what());
+        return 77;
+    }
+    if (devCount == 0)
+    {
+        std::fprintf(stderr, "没有可用的 OpenCL 设备\n");
+        return 77;
+    }
+    if (opt.devices.empty())
+        for (int i = 0; i < devCount; ++i) opt.devices.push_back(i);
+
+    /* SlideOnce 固定使用设备 0 */
+    bool wantSlide = std::find(opt.ops.begin(), opt.ops.end(), "slide") != opt.ops.end();
+    if (wantSlide && std::find(opt.devices.begin(), opt.devices.end(), 0) == opt.devices.end())
+        std::fprintf(stderr, "警告: SlideOnce 只在设备 0 上运行，--devices 不含 0，跳过 slide\n");
+
+    std::vector<Result> results;
+    try
+    {
+        if (opt.tune)
+        {
+            int tuned = CL_Tune(-1);
+            if (tuned == -1)
+            {
+                std::fprintf(stderr, "CL_Tune 失败\n");
+                DisposeOpenCL();
+                return 1;
+            }
+            if (tuned == -2)
+                std::fprintf(stderr, "警告: 调优结果未能写入调优文件，仅本次运行生效\n");
+        }
+
+        if (opt.reorder)
+            CL_SetReorder(1);
+
+        std::printf("%-5s %-3s %-22s %3s | %9s %9s %9s | %8s %8s %8s | %8s %10s |\n",
+                    "op", "dev", "shape", "thr", "p50 ms", "p90 ms", "p99 ms",
+                    "up ms", "comp ms", "down ms", "GB/s", "elem/s");
+        for (int dev : opt.devices)
+        {
+            if (dev < 0 || dev >= devCount)
+            {
+                std::fprintf(stderr, "跳过不存在的设备 %d\n", dev);
+                continue;
+            }
+            char name[256];
+            GetDeviceNames(dev, name, (int)sizeof(name));
+            std::printf("# device %d: %s\n", dev, name);
+
+            size_t first = results.size();
+            for (const auto& op : opt.ops)
+            {
+                if (ReduceOf(op))
+                    BenchReduce(opt, op, dev, name, results);
+                else if (op == "slide" && dev == 0)
+                    BenchSlide(opt, name, results);
+            }
+            for (size_t i = first; i < results.size(); ++i)
+            {
+                Result& r = results[i];
+                /* 重排路径单独成键，基线不会混用两条路径 */
+                r.key = r.op + (r.reorder ? "+reorder" : "") + "/" + r.deviceName + "/" + r.shape +
+                        "/t" + std::to_string(r.threads);
+                PrintResult(r);
+            }
+        }
+    }
+    catch (const std::exception& e)
+    {
+        std::fprintf(stderr, "运行失败: %s\n", e.what());
+        DisposeOpenCL();
+        return 1;
+    }
+    DisposeOpenCL();
+
+    if (!opt.json.empty() && !WriteJson(opt.json, results))
+        std::fprintf(stderr, "写入 %s 失败\n", opt.json.c_str());
+
+    int rc = 0;
+    for (const auto& r : results)
+    {
+        if (r.ok) continue;
+        std::fprintf(stderr, "校验失败: %s (max err %.3g)\n", r.key.c_str(), r.maxErr);
+        rc = 1;
+    }
+
+    if (!opt.baseline.empty())
+    {
+        std::map<std::string, double> base;
+        try
+        {
+            base = ReadBaseline(opt.baseline);
+        }
+        catch (const std::exception& e)
+        {
+            std::fprintf(stderr, "%s\n", e.what());
+            return 64;
+        }
+        int compared = 0, regressions = 0;
+        for (const auto& r : results)
+        {
+            auto it = base.find(r.key);
+            if (it == base.end() || it->second <= 0) continue;
+            ++compared;
+            double ratio = r.p50 / it->second;
+            if (ratio > 1.0 + opt.tolerance)
+            {
+                std::fprintf(stderr, "回退: %s p50 %.4f ms -> %.4f ms (%+.1f%%)\n",
+                             r.key.c_str(), it->second, r.p50, (ratio - 1.0) * 100.0);
+                ++regressions;
+            }
+        }
+        /* 基线中本次没有产生的条目：设备名 / 驱动变化或扫描范围缩小都会导致不可比 */
+        int missing = 0;
+        for (const auto& b : base)
+        {
+            bool found = std::any_of(results.begin(), results.end(),
+                                     [&](const Result& r) { return r.key == b.first; });
+            if (found) continue;
+            std::fprintf(stderr, "基线条目缺失: %s\n", b.first.c_str());
+            ++missing;
+        }
+        std::printf("# baseline: %zu 条基线，%d 条可比，%d 条缺失，%d 条回退（容差 %.0f%%）\n",
+                    base.size(), compared, missing, regressions, opt.tolerance * 100.0);
+        if (rc == 0)
+        {
+            if (compared == 0 || missing > 0 || results.size() < base.size())
+            {
+                std::fprintf(stderr, "基线不可比：没有可比条目或本次结果少于基线\n");
+                rc = 3;
+            }
+            else if (regressions)
+                rc = 2;
+        }
+    }
+    return rc;
+}
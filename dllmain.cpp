@@ -1,7 +1,9 @@
 ﻿// dllmain.cpp — CaptureRGB3 DLL 入口 & OpenCL Loader 定义
 
 #include "pch.h"
+#ifdef _WIN32
 #include <Windows.h>
+#endif
 
 //
 // 1) 全局句柄 & 指针定义（与 pch.h 中 extern 对应）
@@ -30,6 +32,10 @@ PFN_clReleaseKernel            clReleaseKernel = nullptr;
 PFN_clReleaseProgram           clReleaseProgram = nullptr;
 PFN_clReleaseContext           clReleaseContext = nullptr;
 PFN_clGetDeviceInfo            clGetDeviceInfo = nullptr;
+PFN_clGetKernelWorkGroupInfo   clGetKernelWorkGroupInfo = nullptr;
+PFN_clEnqueueWriteBuffer       clEnqueueWriteBuffer = nullptr;
+PFN_clGetEventProfilingInfo    clGetEventProfilingInfo = nullptr;
+PFN_clReleaseEvent             clReleaseEvent = nullptr;
 
 //
 // 2) LoadOpenCL / UnloadOpenCL 实现
@@ -42,6 +48,8 @@ bool LoadOpenCL()
 #define LOAD_FN(fn) (fn = (PFN_##fn)GetProcAddress(gOpenCLLib, #fn)) != nullptr
 #else
     gOpenCLLib = dlopen("libOpenCL.so", RTLD_LAZY | RTLD_LOCAL);
+    // 未装开发包时只有带版本号的运行库
+    if (!gOpenCLLib) gOpenCLLib = dlopen("libOpenCL.so.1", RTLD_LAZY | RTLD_LOCAL);
     if (!gOpenCLLib) return false;
 #define LOAD_FN(fn) (fn = (PFN_##fn)dlsym(gOpenCLLib, #fn)) != nullptr
 #endif
@@ -64,7 +72,11 @@ bool LoadOpenCL()
         LOAD_FN(clReleaseKernel) &&
         LOAD_FN(clReleaseProgram) &&
         LOAD_FN(clReleaseContext) &&
-        LOAD_FN(clGetDeviceInfo);
+        LOAD_FN(clGetDeviceInfo) &&
+        LOAD_FN(clGetKernelWorkGroupInfo) &&
+        LOAD_FN(clEnqueueWriteBuffer) &&
+        LOAD_FN(clGetEventProfilingInfo) &&
+        LOAD_FN(clReleaseEvent);
 
 #undef LOAD_FN
     return ok;
@@ -100,12 +112,17 @@ void UnloadOpenCL()
     CLR(clReleaseProgram);
     CLR(clReleaseContext);
     CLR(clGetDeviceInfo);
+    CLR(clGetKernelWorkGroupInfo);
+    CLR(clEnqueueWriteBuffer);
+    CLR(clGetEventProfilingInfo);
+    CLR(clReleaseEvent);
 #undef CLR
 }
 
 //
-// 3) DLLMain：只做必要的线程通知关闭
+// 3) DLLMain：只做必要的线程通知关闭（仅 Windows）
 //
+#ifdef _WIN32
 BOOL APIENTRY DllMain(
     HMODULE hModule,
     DWORD   ul_reason_for_call,
@@ -123,4 +140,4 @@ BOOL APIENTRY DllMain(
     }
     return TRUE;
 }
-
+#endif
@@ -2,11 +2,27 @@
 #include <vector>
 #include <string>
 #include <mutex>
+#include <atomic>
 #include <stdexcept>
 #include <numeric>
 #include <cstring>   // memcpy
 #include <cmath>
+#include <chrono>
+#include <fstream>
+#include <sstream>
+#include <map>
+#include <algorithm>
+#include <iterator>
+#include <cstdlib>   // getenv / _dupenv_s
+#include <cstdio>    // fprintf
+#ifndef _WIN32
+#include <sys/stat.h>  // mkdir
+#endif
 constexpr auto CL_DEVICE_NAME = 0x102B;
+constexpr auto CL_DRIVER_VERSION = 0x102D;
+constexpr auto CL_KERNEL_WORK_GROUP_SIZE = 0x11B0;
+constexpr auto CL_PROFILING_COMMAND_START = 0x1282;
+constexpr auto CL_PROFILING_COMMAND_END = 0x1283;
 
 // 内部全局状态
 static bool                             g_inited  = false;
@@ -21,6 +37,67 @@ static cl_kernel                        g_mulKer  = nullptr;
 static cl_kernel                        g_divKer  = nullptr;
 static std::mutex                       g_initMutex;
 static cl_kernel                        g_slideKer=nullptr;
+static cl_kernel                        g_addPKer = nullptr;
+static cl_kernel                        g_mulPKer = nullptr;
+
+// 每个设备的调优参数（local == 0 表示走单 work-item 串行核 / 由驱动决定 local）
+// add_p / mul_p 只在 CL_SetReorder(1) 后使用；Sub / Div 始终走串行核
+struct TuneParams
+{
+    int  addLocal   = 0;   // add_p 的 work-group 大小
+    int  addEpt     = 1;   // add_p 每个 work-item 处理的元素数
+    int  mulLocal   = 0;   // mul_p 的 work-group 大小
+    int  mulEpt     = 1;   // mul_p 每个 work-item 处理的元素数
+    int  slideLocal = 0;   // slide_k 的 work-group 大小
+    // 元素数低于此值时直接在主机上计算，按 op 分别测量（kOpAdd..kOpDiv 为下标）
+    // 测到上限仍未找到交叉点时取“上限 + 1”，更大的规模交给设备
+    int  hostCutoff[4] = { 0, 0, 0, 0 };   // 串行核路径
+    int  parCutoff[2]  = { 0, 0 };         // 并行归约路径（Add / Mul，允许重排时使用）
+    bool tuned      = false;
+    bool autoFailed = false;   // 本进程内自动调优失败，沿用默认参数且不再重试
+};
+// 调优候选：work-group 大小（须为 2 的幂，归约树依赖）与每 work-item 元素数
+static const int                        kTuneLocals[] = { 32, 64, 128, 256 };
+static const int                        kTuneEpts[]   = { 1, 4, 16, 64 };
+static std::vector<TuneParams>          g_tune;
+static bool                             g_tuneLoaded = false;
+static std::mutex                       g_tuneMutex;
+// 是否允许 CL_Add / CL_Mul 使用改变计算次序的并行归约（默认关闭，结果与串行核一致）
+static std::atomic<bool>                g_allowReorder(false);
+
+// 最近一次调用的耗时拆分（毫秒），按线程记录；设备路径取自 profiling 事件
+struct LaunchTiming
+{
+    double upload   = 0.0;   // clEnqueueWriteBuffer 执行时长
+    double compute  = 0.0;   // 核执行时长
+    double download = 0.0;   // clEnqueueReadBuffer 执行时长
+};
+static thread_local LaunchTiming        g_lastTiming;
+// 核对象共享，clSetKernelArg 与入队须串行（缓冲区每次调用独立，clFinish 不需加锁）
+static std::mutex                       g_launchMutex;
+
+using Clock = std::chrono::steady_clock;
+static double ElapsedMs(Clock::time_point t0, Clock::time_point t1)
+{
+    return std::chrono::duration<double, std::milli>(t1 - t0).count();
+}
+
+// 读取环境变量，未设置时返回空串（MSVC 下 getenv 触发 C4996，/sdl 时为错误，改用 _dupenv_s）
+static std::string GetEnv(const char* name)
+{
+#ifdef _WIN32
+    char*  buf = nullptr;
+    size_t len = 0;
+    if (_dupenv_s(&buf, &len, name) != 0 || !buf)
+        return "";
+    std::string v(buf);
+    free(buf);
+    return v;
+#else
+    const char* v = std::getenv(name);
+    return v ? v : "";
+#endif
+}
 // OpenCL 内核源码
 static constexpr const char* kCLSrc = R"CLC(
 __kernel void add_k(int n, __global const double* a, __global double* r){
@@ -75,6 +152,39 @@ __kernel void slide_k(
     scores[gid] = 1.f - (float)sad / (float)maxSAD;
     infos [gid] = (int4)(x0, y0, tplW, tplH);
 }
+/* 并行归约：每个 work-group 写出一个部分和/积，由主机合并 */
+__kernel void add_p(int n, __global const double* a,
+                    __global double* r, __local double* tmp)
+{
+    int lid = get_local_id(0);
+    int gsz = get_global_size(0);
+    double s = 0.0;
+    for (int i = get_global_id(0); i < n; i += gsz) s += a[i];
+    tmp[lid] = s;
+    barrier(CLK_LOCAL_MEM_FENCE);
+    for (int k = get_local_size(0) >> 1; k > 0; k >>= 1)
+    {
+        if (lid < k) tmp[lid] += tmp[lid + k];
+        barrier(CLK_LOCAL_MEM_FENCE);
+    }
+    if (lid == 0) r[get_group_id(0)] = tmp[0];
+}
+__kernel void mul_p(int n, __global const double* a,
+                    __global double* r, __local double* tmp)
+{
+    int lid = get_local_id(0);
+    int gsz = get_global_size(0);
+    double p = 1.0;
+    for (int i = get_global_id(0); i < n; i += gsz) p *= a[i];
+    tmp[lid] = p;
+    barrier(CLK_LOCAL_MEM_FENCE);
+    for (int k = get_local_size(0) >> 1; k > 0; k >>= 1)
+    {
+        if (lid < k) tmp[lid] *= tmp[lid + k];
+        barrier(CLK_LOCAL_MEM_FENCE);
+    }
+    if (lid == 0) r[get_group_id(0)] = tmp[0];
+}
 )CLC";
 
 // 确保 OpenCL 库已动态加载
@@ -98,16 +208,29 @@ static void InitOpenCL()
     cl_uint platCnt = 0;
     clGetPlatformIDs(1, &g_platform, &platCnt);
     cl_uint devCnt = 0;
-    clGetDeviceIDs(g_platform, CL_DEVICE_TYPE_GPU, 0, nullptr, &devCnt);
+    cl_device_type devType = CL_DEVICE_TYPE_GPU;
+    clGetDeviceIDs(g_platform, devType, 0, nullptr, &devCnt);
+    // 默认只用 GPU；设置 CLMATH_ALLOW_CPU 后，没有 GPU 时退回到平台上的全部设备（如 pocl 等 CPU 运行时）
+    std::string allowCpu = GetEnv("CLMATH_ALLOW_CPU");
+    if (devCnt == 0 && !allowCpu.empty() && allowCpu != "0")
+    {
+        devType = CL_DEVICE_TYPE_ALL;
+        clGetDeviceIDs(g_platform, devType, 0, nullptr, &devCnt);
+    }
+    if (devCnt == 0)
+    {
+        g_inited = true;
+        return;
+    }
     g_devices.resize(devCnt);
-    clGetDeviceIDs(g_platform, CL_DEVICE_TYPE_GPU,devCnt, g_devices.data(), nullptr);
+    clGetDeviceIDs(g_platform, devType, devCnt, g_devices.data(), nullptr);
     g_context = clCreateContext(nullptr, devCnt, g_devices.data(),nullptr, nullptr, nullptr);
     for (cl_uint i = 0; i < devCnt; ++i)
     {
         g_queues.push_back(
             clCreateCommandQueue(g_context,
                                  g_devices[i],
-                                 0,
+                                 CL_QUEUE_PROFILING_ENABLE,
                                  nullptr));
     }
     const char* srcs[] = { kCLSrc };
@@ -123,8 +246,30 @@ static void InitOpenCL()
     g_mulKer = clCreateKernel(g_program, "mul_k", nullptr);
     g_divKer = clCreateKernel(g_program, "div_k", nullptr);
     g_slideKer = clCreateKernel(g_program, "slide_k", nullptr);
+    g_addPKer = clCreateKernel(g_program, "add_p", nullptr);
+    g_mulPKer = clCreateKernel(g_program, "mul_p", nullptr);
+    g_tune.assign(devCnt, TuneParams());
+    g_tuneLoaded = false;
     g_inited = true;
 }
+// 事件在设备上的执行时长（毫秒），随后释放事件；事件为空时返回 0
+static double EventMs(cl_event evt)
+{
+    if (!evt) return 0.0;
+    cl_ulong start = 0, end = 0;
+    clGetEventProfilingInfo(evt, CL_PROFILING_COMMAND_START, sizeof(cl_ulong), &start, nullptr);
+    clGetEventProfilingInfo(evt, CL_PROFILING_COMMAND_END, sizeof(cl_ulong), &end, nullptr);
+    clReleaseEvent(evt);
+    return (end > start) ? (double)(end - start) * 1e-6 : 0.0;
+}
+
+// OpenCL 调用失败时抛出异常，附带错误码
+static void CheckCL(cl_int err, const char* what)
+{
+    if (err != CL_SUCCESS)
+        throw std::runtime_error(std::string(what) + " failed: " + std::to_string(err));
+}
+
 // 调用任意 kernel
 static double RunKernel(cl_kernel kernel,
                         const double* arr,
@@ -136,61 +281,641 @@ static double RunKernel(cl_kernel kernel,
         throw std::out_of_range("deviceIndex");
 
     size_t bs = sizeof(double) * count;
+    cl_int errA = CL_SUCCESS, errR = CL_SUCCESS;
     cl_mem bufA = clCreateBuffer(
         g_context,
-        CL_MEM_READ_ONLY | CL_MEM_COPY_HOST_PTR,
+        CL_MEM_READ_ONLY,
         bs,
-        (void*)arr,
-        nullptr);
+        nullptr,
+        &errA);
 
     cl_mem bufR = clCreateBuffer(
         g_context,
         CL_MEM_WRITE_ONLY,
         sizeof(double),
         nullptr,
-        nullptr);
+        &errR);
+    cl_int err = (errA != CL_SUCCESS) ? errA : errR;
 
-    clSetKernelArg(kernel, 0, sizeof(int), &count);
-    clSetKernelArg(kernel, 1, sizeof(cl_mem), &bufA);
-    clSetKernelArg(kernel, 2, sizeof(cl_mem), &bufR);
+    /* 显式上传，便于用事件单独计时（COPY_HOST_PTR 的拷贝多被推迟到核启动时） */
+    cl_event evWrite = nullptr, evKernel = nullptr, evRead = nullptr;
+    if (err == CL_SUCCESS)
+        err = clEnqueueWriteBuffer(g_queues[deviceIndex], bufA, CL_TRUE, 0, bs, arr, 0, nullptr, &evWrite);
+    if (err == CL_SUCCESS)
+    {
+        std::lock_guard<std::mutex> lock(g_launchMutex);
+        clSetKernelArg(kernel, 0, sizeof(int), &count);
+        clSetKernelArg(kernel, 1, sizeof(cl_mem), &bufA);
+        clSetKernelArg(kernel, 2, sizeof(cl_mem), &bufR);
 
-    size_t global = 1;
-    clEnqueueNDRangeKernel(
-        g_queues[deviceIndex],
-        kernel,
-        1,
-        nullptr,
-        &global,
-        nullptr,
-        0,
-        nullptr,
-        nullptr);
+        size_t global = 1;
+        err = clEnqueueNDRangeKernel(
+            g_queues[deviceIndex],
+            kernel,
+            1,
+            nullptr,
+            &global,
+            nullptr,
+            0,
+            nullptr,
+            &evKernel);
+    }
 
-    clFinish(g_queues[deviceIndex]);
+    if (err == CL_SUCCESS)
+        err = clFinish(g_queues[deviceIndex]);
 
     double result = 0.0;
-    clEnqueueReadBuffer(
-        g_queues[deviceIndex],
-        bufR,
-        CL_TRUE,
-        0,
-        sizeof(double),
-        &result,
-        0,
+    if (err == CL_SUCCESS)
+        err = clEnqueueReadBuffer(
+            g_queues[deviceIndex],
+            bufR,
+            CL_TRUE,
+            0,
+            sizeof(double),
+            &result,
+            0,
+            nullptr,
+            &evRead);
+
+    g_lastTiming = { EventMs(evWrite), EventMs(evKernel), EventMs(evRead) };
+    if (bufA) clReleaseMemObject(bufA);
+    if (bufR) clReleaseMemObject(bufR);
+    CheckCL(err, "RunKernel");
+
+    return result;
+}
+
+// 并行归约：返回 a[0..n) 的和（mul 为真时为积），次序与串行核不同
+static double RunReduce(cl_kernel kernel,
+                        bool mul,
+                        const double* arr,
+                        int count,
+                        int deviceIndex,
+                        int local,
+                        int ept)
+{
+    size_t bs = sizeof(double) * count;
+    cl_int errA = CL_SUCCESS, errR = CL_SUCCESS;
+    cl_mem bufA = clCreateBuffer(
+        g_context,
+        CL_MEM_READ_ONLY,
+        bs,
+        nullptr,
+        &errA);
+
+    /* global 取 ceil(n / ept) 并向上对齐到 local */
+    size_t lsz = (size_t)local;
+    size_t items = ((size_t)count + ept - 1) / ept;
+    size_t groups = (items + lsz - 1) / lsz;
+    if (groups == 0) groups = 1;
+    size_t global = groups * lsz;
+
+    cl_mem bufR = clCreateBuffer(
+        g_context,
+        CL_MEM_WRITE_ONLY,
+        sizeof(double) * groups,
         nullptr,
-        nullptr);
+        &errR);
+    cl_int err = (errA != CL_SUCCESS) ? errA : errR;
+
+    /* 显式上传，同 RunKernel */
+    cl_event evWrite = nullptr, evKernel = nullptr, evRead = nullptr;
+    if (err == CL_SUCCESS)
+        err = clEnqueueWriteBuffer(g_queues[deviceIndex], bufA, CL_TRUE, 0, bs, arr, 0, nullptr, &evWrite);
+    if (err == CL_SUCCESS)
+    {
+        std::lock_guard<std::mutex> lock(g_launchMutex);
+        clSetKernelArg(kernel, 0, sizeof(int), &count);
+        clSetKernelArg(kernel, 1, sizeof(cl_mem), &bufA);
+        clSetKernelArg(kernel, 2, sizeof(cl_mem), &bufR);
+        clSetKernelArg(kernel, 3, sizeof(double) * lsz, nullptr);
+
+        /* local 超出该核的限制时返回 CL_INVALID_WORK_GROUP_SIZE，核不会执行 */
+        err = clEnqueueNDRangeKernel(
+            g_queues[deviceIndex],
+            kernel,
+            1,
+            nullptr,
+            &global,
+            &lsz,
+            0,
+            nullptr,
+            &evKernel);
+    }
 
-    clReleaseMemObject(bufA);
-    clReleaseMemObject(bufR);
+    if (err == CL_SUCCESS)
+        err = clFinish(g_queues[deviceIndex]);
 
+    std::vector<double> part(groups);
+    if (err == CL_SUCCESS)
+        err = clEnqueueReadBuffer(
+            g_queues[deviceIndex],
+            bufR,
+            CL_TRUE,
+            0,
+            sizeof(double) * groups,
+            part.data(),
+            0,
+            nullptr,
+            &evRead);
+
+    g_lastTiming = { EventMs(evWrite), EventMs(evKernel), EventMs(evRead) };
+    if (bufA) clReleaseMemObject(bufA);
+    if (bufR) clReleaseMemObject(bufR);
+    CheckCL(err, "RunReduce");
+
+    double result = mul ? 1.0 : 0.0;
+    for (double v : part)
+        result = mul ? result * v : result + v;
     return result;
 }
 
+// 滑窗匹配；local == 0 时由驱动决定 work-group 大小
+static int RunSlideKernel(const int* bigImg, int bigH, int bigW, const int* tplImg, int tplH, int tplW, int times, float* scoreBuf, int* infoBuf, int deviceIndex, int local)
+{
+    InitOpenCL();
+    if (deviceIndex < 0 || deviceIndex >= (int)g_devices.size())
+        throw std::out_of_range("deviceIndex");
+    /* 0) 行列 / 步幅计算 */
+    int rows = (int)ceil(sqrt((double)times));
+    int cols = (int)ceil((double)times / rows);
+    int strideY = (rows <= 1) ? (bigH - tplH) : (bigH - tplH) / (rows - 1);
+    int strideX = (cols <= 1) ? (bigW - tplW) : (bigW - tplW) / (cols - 1);
+    int tplPix = tplH * tplW;
+    int maxSAD = 255 * tplPix;
+    int total = rows * cols;
+    /* 1) 设备缓冲区 */
+    size_t bigSz = sizeof(int) * bigH * bigW;
+    size_t tplSz = sizeof(int) * tplH * tplW;
+    size_t scoSz = sizeof(float) * total;
+    size_t infSz = sizeof(cl_int4) * total;
+    cl_int errs[4] = { CL_SUCCESS, CL_SUCCESS, CL_SUCCESS, CL_SUCCESS };
+    cl_mem dBig = clCreateBuffer(g_context, CL_MEM_READ_ONLY, bigSz, nullptr, &errs[0]);
+    cl_mem dTpl = clCreateBuffer(g_context, CL_MEM_READ_ONLY, tplSz, nullptr, &errs[1]);
+    cl_mem dSco = clCreateBuffer(g_context, CL_MEM_WRITE_ONLY, scoSz, nullptr, &errs[2]);
+    cl_mem dInf = clCreateBuffer(g_context, CL_MEM_WRITE_ONLY, infSz, nullptr, &errs[3]);
+    cl_int err = CL_SUCCESS;
+    for (cl_int e : errs)
+        if (err == CL_SUCCESS) err = e;
+    cl_command_queue q = g_queues[deviceIndex];
+    /* 显式上传，事件分别计时 */
+    cl_event evBig = nullptr, evTpl = nullptr, evKernel = nullptr, evSco = nullptr, evInf = nullptr;
+    if (err == CL_SUCCESS)
+        err = clEnqueueWriteBuffer(q, dBig, CL_TRUE, 0, bigSz, bigImg, 0, nullptr, &evBig);
+    if (err == CL_SUCCESS)
+        err = clEnqueueWriteBuffer(q, dTpl, CL_TRUE, 0, tplSz, tplImg, 0, nullptr, &evTpl);
+    if (err == CL_SUCCESS)
+    {
+        /* 2) 设参 */
+        std::lock_guard<std::mutex> lock(g_launchMutex);
+        int idx = 0;
+        clSetKernelArg(g_slideKer, idx++, sizeof(cl_mem), &dBig);
+        clSetKernelArg(g_slideKer, idx++, sizeof(int), &bigW);
+        clSetKernelArg(g_slideKer, idx++, sizeof(int), &bigH);
+        clSetKernelArg(g_slideKer, idx++, sizeof(cl_mem), &dTpl);
+        clSetKernelArg(g_slideKer, idx++, sizeof(int), &tplW);
+        clSetKernelArg(g_slideKer, idx++, sizeof(int), &tplH);
+        clSetKernelArg(g_slideKer, idx++, sizeof(int), &rows);
+        clSetKernelArg(g_slideKer, idx++, sizeof(int), &cols);
+        clSetKernelArg(g_slideKer, idx++, sizeof(int), &strideX);
+        clSetKernelArg(g_slideKer, idx++, sizeof(int), &strideY);
+        clSetKernelArg(g_slideKer, idx++, sizeof(int), &maxSAD);
+        clSetKernelArg(g_slideKer, idx++, sizeof(cl_mem), &dSco);
+        clSetKernelArg(g_slideKer, idx++, sizeof(cl_mem), &dInf);
+        /* 3) 启动核（核内有 gid >= total 判断，global 可向上对齐） */
+        size_t global = total;
+        size_t lsz = (size_t)local;
+        if (local > 0)
+            global = (global + lsz - 1) / lsz * lsz;
+        err = clEnqueueNDRangeKernel(q, g_slideKer, 1, nullptr, &global, local > 0 ? &lsz : nullptr, 0, nullptr, &evKernel);
+    }
+    if (err == CL_SUCCESS)
+        err = clFinish(q);
+    /* 4) 取回结果 */
+    std::vector<float>   tmpSco(total);
+    std::vector<cl_int4> tmpInf(total);
+    if (err == CL_SUCCESS)
+        err = clEnqueueReadBuffer(q, dSco, CL_TRUE, 0, scoSz, tmpSco.data(), 0, nullptr, &evSco);
+    if (err == CL_SUCCESS)
+        err = clEnqueueReadBuffer(q, dInf, CL_TRUE, 0, infSz, tmpInf.data(), 0, nullptr, &evInf);
+    g_lastTiming = { EventMs(evBig) + EventMs(evTpl), EventMs(evKernel), EventMs(evSco) + EventMs(evInf) };
+
+    if (dBig) clReleaseMemObject(dBig);
+    if (dTpl) clReleaseMemObject(dTpl);
+    if (dSco) clReleaseMemObject(dSco);
+    if (dInf) clReleaseMemObject(dInf);
+    CheckCL(err, "RunSlideKernel");
+
+    /* 5) 过滤无效窗 */
+    int valid = 0;
+    for (int i = 0; i < total; ++i)
+    {
+        if (tmpSco[i] < 0) continue;
+        scoreBuf[valid] = tmpSco[i];
+        infoBuf[valid * 4 + 0] = tmpInf[i].s[0];
+        infoBuf[valid * 4 + 1] = tmpInf[i].s[1];
+        infoBuf[valid * 4 + 2] = tmpInf[i].s[2];
+        infoBuf[valid * 4 + 3] = tmpInf[i].s[3];
+        ++valid;
+    }
+    return valid;
+}
+
+// -----------------------------------------------------------------------------
+// 四则运算分派（按调优结果选择主机 / 串行核 / 并行归约）
+// 并行归约改变了求和 / 求积次序，可能在串行核有限的输入上溢出为 inf 或得到 NaN，
+// 因此只对 Add / Mul 且在调用方通过 CL_SetReorder 明确允许时使用
+// -----------------------------------------------------------------------------
+enum { kOpAdd = 0, kOpSub, kOpMul, kOpDiv };
+
+// 主机计算，次序与串行核一致
+static double RunHost(int op, const double* arr, int count)
+{
+    if (count <= 0)
+        return (op == kOpMul) ? 1.0 : 0.0;
+    double v = (op == kOpAdd) ? 0.0 : (op == kOpMul) ? 1.0 : arr[0];
+    int i0 = (op == kOpSub || op == kOpDiv) ? 1 : 0;
+    for (int i = i0; i < count; ++i)
+    {
+        switch (op)
+        {
+        case kOpAdd: v += arr[i]; break;
+        case kOpSub: v -= arr[i]; break;
+        case kOpMul: v *= arr[i]; break;
+        default:     v /= arr[i]; break;
+        }
+    }
+    return v;
+}
+
+static cl_kernel SerialKernel(int op)
+{
+    switch (op)
+    {
+    case kOpAdd: return g_addKer;
+    case kOpSub: return g_subKer;
+    case kOpMul: return g_mulKer;
+    default:     return g_divKer;
+    }
+}
+
+// 按给定参数在设备上执行（不查调优表，供调优器与分派共用）
+// local > 0 仅对 Add / Mul 有效，表示使用并行归约
+static double RunDevice(int op, const double* arr, int count, int deviceIndex, int local, int ept)
+{
+    if (local <= 0 || op == kOpSub || op == kOpDiv)
+        return RunKernel(SerialKernel(op), arr, count, deviceIndex);
+    bool mul = (op == kOpMul);
+    return RunReduce(mul ? g_mulPKer : g_addPKer, mul, arr, count, deviceIndex, local, ept);
+}
+
+// -----------------------------------------------------------------------------
+// 自动调优：对每个设备测试候选配置，结果按“设备名 + 驱动版本”写入调优文件
+// 文件格式（每行一个设备）：
+//   设备名\t驱动版本\taddLocal addEpt mulLocal mulEpt slideLocal
+//                     hostCutoff[Add Sub Mul Div] parCutoff[Add Mul]
+// 字段数不符（旧格式）或取值非法的条目视为未调优
+// -----------------------------------------------------------------------------
+static std::string QueryDeviceString(cl_device_id dev, cl_device_info param)
+{
+    size_t len = 0;
+    clGetDeviceInfo(dev, param, 0, nullptr, &len);
+    std::vector<char> tmp(len + 1, '\0');
+    clGetDeviceInfo(dev, param, len, tmp.data(), nullptr);
+    std::string s(tmp.data());
+    /* 制表符 / 换行是文件分隔符，替换掉 */
+    std::replace(s.begin(), s.end(), '\t', ' ');
+    std::replace(s.begin(), s.end(), '\n', ' ');
+    return s;
+}
+
+static std::string TuneKey(int deviceIndex)
+{
+    return QueryDeviceString(g_devices[deviceIndex], CL_DEVICE_NAME) + "\t" +
+           QueryDeviceString(g_devices[deviceIndex], CL_DRIVER_VERSION);
+}
+
+// 调优文件路径：环境变量 CLMATH_TUNE_FILE，否则放在用户缓存目录
+//   Windows：%LOCALAPPDATA%\CLMath\CLMath.tune
+//   其它：   $XDG_CACHE_HOME/clmath/CLMath.tune 或 ~/.cache/clmath/CLMath.tune
+// 都取不到时退回当前目录
+static std::string TuneFilePath()
+{
+    std::string path = GetEnv("CLMATH_TUNE_FILE");
+    if (!path.empty()) return path;
+#ifdef _WIN32
+    std::string base = GetEnv("LOCALAPPDATA");
+    if (!base.empty()) return base + "\\CLMath\\CLMath.tune";
+#else
+    std::string base = GetEnv("XDG_CACHE_HOME");
+    if (base.empty() && !GetEnv("HOME").empty()) base = GetEnv("HOME") + "/.cache";
+    if (!base.empty()) return base + "/clmath/CLMath.tune";
+#endif
+    return "CLMath.tune";
+}
+
+// 逐级创建文件所在目录（已存在时忽略）
+static void MakeParentDirs(const std::string& file)
+{
+    for (size_t pos = file.find_first_of("/\\", 1); pos != std::string::npos;
+         pos = file.find_first_of("/\\", pos + 1))
+    {
+        std::string dir = file.substr(0, pos);
+#ifdef _WIN32
+        CreateDirectoryA(dir.c_str(), nullptr);
+#else
+        mkdir(dir.c_str(), 0755);
+#endif
+    }
+}
+
+// 首次使用时是否自动调优：需设置环境变量 CLMATH_AUTOTUNE（非 "0"），否则只读调优文件
+static bool AutoTuneEnabled()
+{
+    std::string v = GetEnv("CLMATH_AUTOTUNE");
+    return !v.empty() && v != "0";
+}
+
+static std::map<std::string, std::string> ReadTuneFile()
+{
+    std::map<std::string, std::string> entries;
+    std::ifstream in(TuneFilePath());
+    std::string line;
+    while (std::getline(in, line))
+    {
+        if (!line.empty() && line.back() == '\r') line.pop_back();
+        size_t t1 = line.find('\t');
+        size_t t2 = (t1 == std::string::npos) ? t1 : line.find('\t', t1 + 1);
+        if (t2 == std::string::npos) continue;
+        entries[line.substr(0, t2)] = line.substr(t2 + 1);
+    }
+    return entries;
+}
+
+// 该核在设备上允许的最大 work-group 大小（可能小于设备上限）
+static size_t KernelMaxLocal(cl_kernel kernel, int deviceIndex)
+{
+    size_t wg = 0;
+    if (clGetKernelWorkGroupInfo(kernel, g_devices[deviceIndex], CL_KERNEL_WORK_GROUP_SIZE,
+                                 sizeof(size_t), &wg, nullptr) != CL_SUCCESS)
+        return 0;
+    return wg;
+}
+
+// 调优文件中的参数只接受调优器可能产生、且该设备上的核能接受的取值
+// （ept 为 0 会除零，local 非 2 的幂时 add_p / mul_p 的归约树会漏元素）
+static bool ValidTuneParams(const TuneParams& tp, int deviceIndex)
+{
+    auto localOk = [&](int v, cl_kernel kernel) {
+        if (v == 0) return true;
+        return std::find(std::begin(kTuneLocals), std::end(kTuneLocals), v) != std::end(kTuneLocals) &&
+               (size_t)v <= KernelMaxLocal(kernel, deviceIndex);
+    };
+    auto eptOk = [](int v) {
+        return std::find(std::begin(kTuneEpts), std::end(kTuneEpts), v) != std::end(kTuneEpts);
+    };
+    if (!localOk(tp.addLocal, g_addPKer) || !localOk(tp.mulLocal, g_mulPKer) || !localOk(tp.slideLocal, g_slideKer))
+        return false;
+    if (!eptOk(tp.addEpt) || !eptOk(tp.mulEpt))
+        return false;
+    for (int c : tp.hostCutoff) if (c < 0) return false;
+    for (int c : tp.parCutoff)  if (c < 0) return false;
+    return true;
+}
+
+static void LoadTuneFile()
+{
+    std::map<std::string, std::string> entries = ReadTuneFile();
+    for (size_t i = 0; i < g_devices.size(); ++i)
+    {
+        auto it = entries.find(TuneKey((int)i));
+        if (it == entries.end()) continue;
+        TuneParams tp;
+        std::istringstream ss(it->second);
+        ss >> tp.addLocal >> tp.addEpt >> tp.mulLocal >> tp.mulEpt >> tp.slideLocal;
+        for (int& c : tp.hostCutoff) ss >> c;
+        for (int& c : tp.parCutoff)  ss >> c;
+        std::string extra;
+        if (ss && !(ss >> extra) && ValidTuneParams(tp, (int)i))
+        {
+            tp.tuned = true;
+            g_tune[i] = tp;
+        }
+    }
+    g_tuneLoaded = true;
+}
+
+// 合并写回：保留文件中其它设备 / 驱动版本的条目；写入失败时输出到 stderr 并返回 false
+static bool SaveTuneFile()
+{
+    std::map<std::string, std::string> entries = ReadTuneFile();
+    for (size_t i = 0; i < g_devices.size(); ++i)
+    {
+        const TuneParams& tp = g_tune[i];
+        if (!tp.tuned) continue;
+        std::ostringstream ss;
+        ss << tp.addLocal << ' ' << tp.addEpt << ' '
+           << tp.mulLocal << ' ' << tp.mulEpt << ' '
+           << tp.slideLocal;
+        for (int c : tp.hostCutoff) ss << ' ' << c;
+        for (int c : tp.parCutoff)  ss << ' ' << c;
+        entries[TuneKey((int)i)] = ss.str();
+    }
+    std::string path = TuneFilePath();
+    MakeParentDirs(path);
+    std::ofstream out(path, std::ios::trunc);
+    for (const auto& e : entries)
+        out << e.first << '\t' << e.second << '\n';
+    out.close();
+    if (!out)
+    {
+        std::fprintf(stderr, "CLMath: 无法写入调优文件 %s\n", path.c_str());
+        return false;
+    }
+    return true;
+}
+
+static volatile double g_tuneSink = 0.0;   // 防止主机基准被优化掉
+
+// 预热一次后取 reps 次中的最短耗时（秒）
+template <class F>
+static double BestTime(int reps, F&& fn)
+{
+    fn();
+    double best = 1e300;
+    for (int r = 0; r < reps; ++r)
+    {
+        auto t0 = std::chrono::steady_clock::now();
+        fn();
+        auto t1 = std::chrono::steady_clock::now();
+        best = (std::min)(best, std::chrono::duration<double>(t1 - t0).count());
+    }
+    return best;
+}
+
+static void TuneDevice(int deviceIndex)
+{
+    constexpr int kTuneN    = 1 << 18;
+    constexpr int kReps     = 3;
+
+    TuneParams tp;
+    /* 整数和 / ±1 的积在任何次序下都精确，可用来逐位校验候选配置 */
+    std::vector<double> addData(kTuneN), mulData(kTuneN);
+    for (int i = 0; i < kTuneN; ++i)
+    {
+        addData[i] = (double)(i % 7);
+        mulData[i] = (i % 3 == 0) ? -1.0 : 1.0;
+    }
+
+    /* 1) 归约核：串行核 vs. 各 (local, ept) 组合；启动失败或结果与主机不一致的配置淘汰 */
+    auto tuneReduce = [&](int op, const std::vector<double>& in, cl_kernel kernel, int& outLocal, int& outEpt)
+    {
+        const double expect = RunHost(op, in.data(), kTuneN);
+        auto measure = [&](int local, int ept) -> double
+        {
+            bool ok = true;
+            double t = 0.0;
+            try
+            {
+                t = BestTime(kReps, [&] { ok = (RunDevice(op, in.data(), kTuneN, deviceIndex, local, ept) == expect) && ok; });
+            }
+            catch (const std::runtime_error&)
+            {
+                return -1.0;
+            }
+            return ok ? t : -1.0;
+        };
+        outLocal = 0;
+        outEpt   = 1;
+        double best = measure(0, 1);
+        if (best < 0)
+            throw std::runtime_error("TuneDevice: serial kernel failed");
+        size_t maxLocal = KernelMaxLocal(kernel, deviceIndex);
+        for (int local : kTuneLocals)
+        {
+            if ((size_t)local > maxLocal) continue;
+            for (int ept : kTuneEpts)
+            {
+                double t = measure(local, ept);
+                if (t >= 0 && t < best) { best = t; outLocal = local; outEpt = ept; }
+            }
+        }
+    };
+    tuneReduce(kOpAdd, addData, g_addPKer, tp.addLocal, tp.addEpt);
+    tuneReduce(kOpMul, mulData, g_mulPKer, tp.mulLocal, tp.mulEpt);
+
+    /* 2) 主机 / 设备分界点：每个 op / 路径分别测量设备首次快于主机的规模 */
+    constexpr int kCutoffMax  = 1 << 22;
+    constexpr int kCutoffReps = 2;
+    std::vector<double> sweep(kCutoffMax, 1.0);
+    auto crossover = [&](int op, int local, int ept)
+    {
+        for (int n = 16; n <= kCutoffMax; n *= 4)
+        {
+            double th = BestTime(kCutoffReps, [&] { g_tuneSink = RunHost(op, sweep.data(), n); });
+            double td = BestTime(kCutoffReps, [&] { g_tuneSink = RunDevice(op, sweep.data(), n, deviceIndex, local, ept); });
+            if (td < th) return n;
+        }
+        return kCutoffMax + 1;
+    };
+    for (int op = kOpAdd; op <= kOpDiv; ++op)
+        tp.hostCutoff[op] = crossover(op, 0, 1);
+    tp.parCutoff[0] = tp.addLocal > 0 ? crossover(kOpAdd, tp.addLocal, tp.addEpt) : tp.hostCutoff[kOpAdd];
+    tp.parCutoff[1] = tp.mulLocal > 0 ? crossover(kOpMul, tp.mulLocal, tp.mulEpt) : tp.hostCutoff[kOpMul];
+
+    /* 3) 滑窗核 work-group 大小；以驱动自选 local 的输出为准，结果不同的配置淘汰 */
+    constexpr int kBigW = 256, kBigH = 256, kTplW = 16, kTplH = 16, kTimes = 1024;
+    std::vector<int> big(kBigW * kBigH), tpl(kTplW * kTplH);
+    for (size_t i = 0; i < big.size(); ++i) big[i] = (int)(i * 37 % 256);
+    for (size_t i = 0; i < tpl.size(); ++i) tpl[i] = (int)(i * 11 % 256);
+    std::vector<float> refSco(kTimes * 2), sco(kTimes * 2);
+    std::vector<int>   refInf(kTimes * 2 * 4), inf(kTimes * 2 * 4);
+    int refValid = 0;
+    double best = BestTime(kReps, [&] {
+        refValid = RunSlideKernel(big.data(), kBigH, kBigW, tpl.data(), kTplH, kTplW, kTimes, refSco.data(), refInf.data(), deviceIndex, 0);
+    });
+    tp.slideLocal = 0;
+    size_t maxLocal = KernelMaxLocal(g_slideKer, deviceIndex);
+    for (int local : kTuneLocals)
+    {
+        if ((size_t)local > maxLocal) continue;
+        bool ok = true;
+        double t = 0.0;
+        try
+        {
+            t = BestTime(kReps, [&] {
+                int valid = RunSlideKernel(big.data(), kBigH, kBigW, tpl.data(), kTplH, kTplW, kTimes, sco.data(), inf.data(), deviceIndex, local);
+                ok = ok && valid == refValid &&
+                     std::equal(sco.begin(), sco.begin() + valid, refSco.begin()) &&
+                     std::equal(inf.begin(), inf.begin() + valid * 4, refInf.begin());
+            });
+        }
+        catch (const std::runtime_error&)
+        {
+            continue;
+        }
+        if (ok && t < best) { best = t; tp.slideLocal = local; }
+    }
+
+    tp.tuned = true;
+    g_tune[deviceIndex] = tp;
+}
+
+// 取设备调优参数；首次使用时先读调优文件。没有记录时用默认参数（与未调优时行为一致），
+// 只有设置了 CLMATH_AUTOTUNE 才现场调优并写回（写回失败也保留在内存中，本进程不再重复调优）；
+// 调优失败时输出到 stderr，沿用默认参数，本进程不再重试
+static TuneParams GetTuneParams(int deviceIndex)
+{
+    std::lock_guard<std::mutex> lock(g_tuneMutex);
+    if (!g_tuneLoaded)
+        LoadTuneFile();
+    TuneParams& tp = g_tune[deviceIndex];
+    if (!tp.tuned && !tp.autoFailed && AutoTuneEnabled())
+    {
+        try
+        {
+            TuneDevice(deviceIndex);
+            SaveTuneFile();
+        }
+        catch (const std::exception& e)
+        {
+            std::fprintf(stderr, "CLMath: 设备 %d 自动调优失败，使用默认参数: %s\n", deviceIndex, e.what());
+            tp = TuneParams();
+            tp.autoFailed = true;
+        }
+    }
+    return tp;
+}
+
+static double RunOp(int op, const double* arr, int count, int deviceIndex)
+{
+    InitOpenCL();
+    if (deviceIndex < 0 || deviceIndex >= (int)g_devices.size())
+        throw std::out_of_range("deviceIndex");
+    TuneParams tp = GetTuneParams(deviceIndex);
+    int local = 0, ept = 1, cutoff = tp.hostCutoff[op];
+    if (g_allowReorder)
+    {
+        if (op == kOpAdd && tp.addLocal > 0) { local = tp.addLocal; ept = tp.addEpt; cutoff = tp.parCutoff[0]; }
+        if (op == kOpMul && tp.mulLocal > 0) { local = tp.mulLocal; ept = tp.mulEpt; cutoff = tp.parCutoff[1]; }
+    }
+    if (count <= 0 || count < cutoff)
+    {
+        auto t0 = Clock::now();
+        double r = RunHost(op, arr, count);
+        g_lastTiming = { 0.0, ElapsedMs(t0, Clock::now()), 0.0 };
+        return r;
+    }
+    return RunDevice(op, arr, count, deviceIndex, local, ept);
+}
+
 extern "C"
 {
     int __cdecl SlideOnce(const int* bigImg, int bigH, int bigW,const int* tplImg, int tplH, int tplW,int times,float* scoreBuf,int* infoBuf)
     {
-        return RunSlideKernel(bigImg, bigH, bigW, tplImg, tplH, tplW, times, scoreBuf, infoBuf);
+        InitOpenCL();
+        int local = g_devices.empty() ? 0 : GetTuneParams(0).slideLocal;
+        return RunSlideKernel(bigImg, bigH, bigW, tplImg, tplH, tplW, times, scoreBuf, infoBuf, 0, local);
     }
 // 返回设备数量
     int __cdecl GetDeviceNamesCount()
@@ -228,90 +953,62 @@ extern "C"
 // 四则运算
     double __cdecl CL_Add(const double* arr, int count, int deviceIndex)
     {
-    return RunKernel(g_addKer, arr, count, deviceIndex);
+    return RunOp(kOpAdd, arr, count, deviceIndex);
     DisposeOpenCL();
     }
     double __cdecl CL_Sub(const double* arr, int count, int deviceIndex)
     {
-    return RunKernel(g_subKer, arr, count, deviceIndex); 
+    return RunOp(kOpSub, arr, count, deviceIndex); 
     DisposeOpenCL();
 
     }
 
     double __cdecl CL_Mul(const double* arr, int count, int deviceIndex)
     {
-    return RunKernel(g_mulKer, arr, count, deviceIndex);
+    return RunOp(kOpMul, arr, count, deviceIndex);
     DisposeOpenCL();
     }
     double __cdecl CL_Div(const double* arr, int count, int deviceIndex)
     {
-    return RunKernel(g_divKer, arr, count, deviceIndex);    
+    return RunOp(kOpDiv, arr, count, deviceIndex);    
     DisposeOpenCL();
     }
-//网络 
-    static int RunSlideKernel(const int* bigImg, int bigH, int bigW,const int* tplImg, int tplH, int tplW,int times,float* scoreBuf,int* infoBuf)
+// 最近一次调用的耗时拆分
+    void __cdecl CL_GetLastTiming(double* uploadMs, double* computeMs, double* downloadMs)
+    {
+    if (uploadMs)   *uploadMs   = g_lastTiming.upload;
+    if (computeMs)  *computeMs  = g_lastTiming.compute;
+    if (downloadMs) *downloadMs = g_lastTiming.download;
+    }
+// 允许 / 禁止 Add、Mul 使用重排次序的并行归约
+    void __cdecl CL_SetReorder(int allow)
+    {
+    g_allowReorder = (allow != 0);
+    }
+// 重新调优并写回调优文件
+    int __cdecl CL_Tune(int deviceIndex)
+    {
+    // 任何异常（运行时缺失、内存不足、设备错误）都不能穿过 C 接口
+    try
     {
         InitOpenCL();
-    /* 0) 行列 / 步幅计算 */
-        int rows = (int)ceil(sqrt((double)times));
-     int cols = (int)ceil((double)times / rows);
-      int strideY = (rows <= 1) ? (bigH - tplH) : (bigH - tplH) / (rows - 1);
-      int strideX = (cols <= 1) ? (bigW - tplW) : (bigW - tplW) / (cols - 1);
-       int tplPix = tplH * tplW;
-       int maxSAD = 255 * tplPix;
-      int total = rows * cols;
-       /* 1) 设备缓冲区 */
-       size_t bigSz = sizeof(int) * bigH * bigW;
-       size_t tplSz = sizeof(int) * tplH * tplW;
-      size_t scoSz = sizeof(float) * total;
-      size_t infSz = sizeof(cl_int4) * total;
-      cl_mem dBig = clCreateBuffer(g_context, CL_MEM_READ_ONLY | CL_MEM_COPY_HOST_PTR, bigSz, (void*)bigImg, nullptr);
-      cl_mem dTpl = clCreateBuffer(g_context, CL_MEM_READ_ONLY | CL_MEM_COPY_HOST_PTR, tplSz, (void*)tplImg, nullptr);
-      cl_mem dSco = clCreateBuffer(g_context, CL_MEM_WRITE_ONLY, scoSz, nullptr, nullptr);
-      cl_mem dInf = clCreateBuffer(g_context, CL_MEM_WRITE_ONLY, infSz, nullptr, nullptr);
-    /* 2) 设参 */
-       int idx = 0;
-      clSetKernelArg(g_slideKer, idx++, sizeof(cl_mem), &dBig);
-       clSetKernelArg(g_slideKer, idx++, sizeof(int), &bigW);
-        clSetKernelArg(g_slideKer, idx++, sizeof(int), &bigH);
-        clSetKernelArg(g_slideKer, idx++, sizeof(cl_mem), &dTpl);
-        clSetKernelArg(g_slideKer, idx++, sizeof(int), &tplW);
-        clSetKernelArg(g_slideKer, idx++, sizeof(int), &tplH);
-      clSetKernelArg(g_slideKer, idx++, sizeof(int), &rows);
-       clSetKernelArg(g_slideKer, idx++, sizeof(int), &cols);
-        clSetKernelArg(g_slideKer, idx++, sizeof(int), &strideX);
-       clSetKernelArg(g_slideKer, idx++, sizeof(int), &strideY);
-      clSetKernelArg(g_slideKer, idx++, sizeof(int), &maxSAD);
-       clSetKernelArg(g_slideKer, idx++, sizeof(cl_mem), &dSco);
-       clSetKernelArg(g_slideKer, idx++, sizeof(cl_mem), &dInf);
-    /* 3) 启动核并同步 */
-    size_t global = total;
-        clEnqueueNDRangeKernel(g_queues[0], g_slideKer, 1, nullptr, &global, nullptr, 0, nullptr, nullptr);
-         clFinish(g_queues[0]);
-    /* 4) 取回结果 */
-        std::vector<float>   tmpSco(total);
-        std::vector<cl_int4> tmpInf(total);
-        clEnqueueReadBuffer(g_queues[0], dSco, CL_TRUE, 0, scoSz, tmpSco.data(), 0, nullptr, nullptr);
-        clEnqueueReadBuffer(g_queues[0], dInf, CL_TRUE, 0, infSz, tmpInf.data(), 0, nullptr, nullptr);
-
-        clReleaseMemObject(dBig);
-        clReleaseMemObject(dTpl);
-        clReleaseMemObject(dSco);
-        clReleaseMemObject(dInf);
-
-    /* 5) 过滤无效窗 */
-         int valid = 0;
-        for (int i = 0; i < total; ++i)
-        {
-            if (tmpSco[i] < 0) continue;
-            scoreBuf[valid] = tmpSco[i];
-            infoBuf[valid * 4 + 0] = tmpInf[i].s[0];
-            infoBuf[valid * 4 + 1] = tmpInf[i].s[1];
-            infoBuf[valid * 4 + 2] = tmpInf[i].s[2];
-            infoBuf[valid * 4 + 3] = tmpInf[i].s[3];
-            ++valid;
-        }
-    return valid;
+        if (deviceIndex < -1 || deviceIndex >= (int)g_devices.size())
+            return -1;
+        std::lock_guard<std::mutex> lock(g_tuneMutex);
+        if (!g_tuneLoaded)
+            LoadTuneFile();
+        int first = (deviceIndex < 0) ? 0 : deviceIndex;
+        int last  = (deviceIndex < 0) ? (int)g_devices.size() : deviceIndex + 1;
+        for (int i = first; i < last; ++i)
+            TuneDevice(i);
+        if (!SaveTuneFile())
+            return -2;
+        return last - first;
+    }
+    catch (const std::exception&)
+    {
+        return -1;
+    }
     }
 // 释放所有 OpenCL 资源
 void __cdecl DisposeOpenCL()
@@ -326,7 +1023,14 @@ void __cdecl DisposeOpenCL()
     clReleaseKernel(g_subKer);
     clReleaseKernel(g_mulKer);
     clReleaseKernel(g_divKer);
+    clReleaseKernel(g_slideKer);
+    clReleaseKernel(g_addPKer);
+    clReleaseKernel(g_mulPKer);
     g_addKer = g_subKer = g_mulKer = g_divKer = nullptr;
+    g_slideKer = g_addPKer = g_mulPKer = nullptr;
+    // 清空调优参数（调优文件保留，下次初始化重新读取）
+    g_tune.clear();
+    g_tuneLoaded = false;
     // 释放 program
     if (g_program) clReleaseProgram(g_program);
     g_program = nullptr;
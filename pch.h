@@ -18,6 +18,20 @@
   #include <dlfcn.h>
 #endif
 
+// 导出宏：Windows 下 CLMATH_EXPORTS 区分导出/导入，其它平台按可见性导出
+#ifdef _WIN32
+  #ifdef CLMATH_EXPORTS
+    #define CLMATH_API __declspec(dllexport)
+  #else
+    #define CLMATH_API __declspec(dllimport)
+  #endif
+#else
+  #define CLMATH_API __attribute__((visibility("default")))
+  #ifndef __cdecl
+    #define __cdecl
+  #endif
+#endif
+
 #ifdef __cplusplus
 extern "C" {
 #endif
@@ -34,6 +48,9 @@ typedef cl_bitfield         cl_command_queue_properties;
 typedef size_t              cl_context_properties;
 typedef cl_uint             cl_bool;
 typedef cl_uint             cl_device_info;
+typedef cl_uint             cl_kernel_work_group_info;
+typedef cl_uint             cl_profiling_info;
+typedef unsigned long long  cl_ulong;
 
 typedef struct _cl_platform_id*     cl_platform_id;
 typedef struct _cl_device_id*       cl_device_id;
@@ -42,6 +59,7 @@ typedef struct _cl_command_queue*   cl_command_queue;
 typedef struct _cl_program*         cl_program;
 typedef struct _cl_kernel*          cl_kernel;
 typedef struct _cl_mem*             cl_mem;
+typedef struct _cl_event*           cl_event;
 
 #define CL_SUCCESS                 0
 #define CL_TRUE                    1
@@ -54,11 +72,14 @@ typedef struct { cl_int s[4]; } cl_int4;
 __attribute__((aligned(16)))
 #endif
 #define CL_DEVICE_TYPE_GPU         (1 << 2)
+#define CL_DEVICE_TYPE_ALL         0xFFFFFFFF
 
 #define CL_MEM_READ_ONLY           (1 << 0)
 #define CL_MEM_WRITE_ONLY          (1 << 1)
 #define CL_MEM_COPY_HOST_PTR       (1 << 3)
 
+#define CL_QUEUE_PROFILING_ENABLE  (1 << 1)
+
 // -----------------------------------------------------------------------------
 // OpenCL 函数指针 typedef 与 extern 声明（保持原样）
 // -----------------------------------------------------------------------------
@@ -119,6 +140,21 @@ typedef cl_int  (*PFN_clEnqueueReadBuffer)     (cl_command_queue,
                                                 cl_uint,
                                                 const void*,
                                                 void*);
+typedef cl_int  (*PFN_clEnqueueWriteBuffer)    (cl_command_queue,
+                                                cl_mem,
+                                                cl_bool,
+                                                size_t,
+                                                size_t,
+                                                const void*,
+                                                cl_uint,
+                                                const void*,
+                                                void*);
+typedef cl_int  (*PFN_clGetEventProfilingInfo) (cl_event,
+                                                cl_profiling_info,
+                                                size_t,
+                                                void*,
+                                                size_t*);
+typedef cl_int  (*PFN_clReleaseEvent)          (cl_event);
 typedef cl_int  (*PFN_clReleaseMemObject)      (cl_mem);
 typedef cl_int  (*PFN_clReleaseCommandQueue)   (cl_command_queue);
 typedef cl_int  (*PFN_clReleaseKernel)         (cl_kernel);
@@ -129,6 +165,12 @@ typedef cl_int  (*PFN_clGetDeviceInfo)         (cl_device_id,
                                                 size_t,
                                                 void*,
                                                 size_t*);
+typedef cl_int  (*PFN_clGetKernelWorkGroupInfo)(cl_kernel,
+                                                cl_device_id,
+                                                cl_kernel_work_group_info,
+                                                size_t,
+                                                void*,
+                                                size_t*);
 
 extern PFN_clGetPlatformIDs           clGetPlatformIDs;
 extern PFN_clGetDeviceIDs             clGetDeviceIDs;
@@ -148,6 +190,10 @@ extern PFN_clReleaseKernel            clReleaseKernel;
 extern PFN_clReleaseProgram           clReleaseProgram;
 extern PFN_clReleaseContext           clReleaseContext;
 extern PFN_clGetDeviceInfo            clGetDeviceInfo;
+extern PFN_clGetKernelWorkGroupInfo   clGetKernelWorkGroupInfo;
+extern PFN_clEnqueueWriteBuffer       clEnqueueWriteBuffer;
+extern PFN_clGetEventProfilingInfo    clGetEventProfilingInfo;
+extern PFN_clReleaseEvent             clReleaseEvent;
 
 // 动态加载/卸载 OpenCL
 bool LoadOpenCL();
@@ -157,33 +203,56 @@ void UnloadOpenCL();
 // 下面全部改为 C API 导出声明（删除原 namespace CLMath）
 // -----------------------------------------------------------------------------
 
-// 返回可用 GPU 设备数量
-__declspec(dllexport) int __cdecl GetDeviceNamesCount();
+// 返回可用 GPU 设备数量（设置环境变量 CLMATH_ALLOW_CPU=1 且没有 GPU 时，改为平台上的全部设备）
+CLMATH_API int __cdecl GetDeviceNamesCount();
 
 // 获取单个设备名称，写入 buf 并返回实际长度
-__declspec(dllexport) int __cdecl GetDeviceNames(int index,
+CLMATH_API int __cdecl GetDeviceNames(int index,
                                                  char* buf,
                                                  int bufSize);
 
 // 四则运算接口
-__declspec(dllexport) double __cdecl CL_Add(const double* arr,
+CLMATH_API double __cdecl CL_Add(const double* arr,
                                             int count,
                                             int deviceIndex);
 
-__declspec(dllexport) double __cdecl CL_Sub(const double* arr,
+CLMATH_API double __cdecl CL_Sub(const double* arr,
                                             int count,
                                             int deviceIndex);
 
-__declspec(dllexport) double __cdecl CL_Mul(const double* arr,
+CLMATH_API double __cdecl CL_Mul(const double* arr,
                                             int count,
                                             int deviceIndex);
 
-__declspec(dllexport) double __cdecl CL_Div(const double* arr,
+CLMATH_API double __cdecl CL_Div(const double* arr,
                                             int count,
                                             int deviceIndex);
 
+// 滑窗匹配（固定使用设备 0），返回有效窗口数
+CLMATH_API int __cdecl SlideOnce(const int* bigImg, int bigH, int bigW,
+                                 const int* tplImg, int tplH, int tplW,
+                                 int times,
+                                 float* scoreBuf,
+                                 int* infoBuf);
+
+// 当前线程最近一次调用的耗时拆分（毫秒）：上传 / 计算 / 回读
+// 取自设备 profiling 事件（写缓冲区 / 核执行 / 读缓冲区），不含排队与锁等待
+// 走主机路径时上传与回读为 0，计算为主机耗时
+CLMATH_API void __cdecl CL_GetLastTiming(double* uploadMs,
+                                         double* computeMs,
+                                         double* downloadMs);
+
+// 允许 CL_Add / CL_Mul 使用调优得到的并行归约（allow 非 0 时生效，默认关闭）
+// 并行归约改变计算次序：舍入可能不同，串行结果有限时也可能得到 inf / NaN
+// CL_Sub / CL_Div 始终按原次序计算
+CLMATH_API void __cdecl CL_SetReorder(int allow);
+
+// 重新对设备做自动调优并写回调优文件（deviceIndex = -1 表示全部设备）
+// 返回调优的设备数量；参数错误或调优失败返回 -1，调优文件写入失败返回 -2（本进程内仍生效）
+CLMATH_API int __cdecl CL_Tune(int deviceIndex);
+
 // 释放所有 OpenCL 资源
-__declspec(dllexport) void __cdecl DisposeOpenCL();
+CLMATH_API void __cdecl DisposeOpenCL();
 #ifdef __cplusplus
 } // extern "C"
 #endif